@@ -5,14 +5,47 @@
 #include "Components/PrimitiveComponent.h"    
 #include "GameFramework/Character.h"      
 #include "Engine/Engine.h"    
+#include "EngineUtils.h"
 #include "IEnemyVisibilityInterface.h"  
 #include "GhostActor.h"
 #include "Components/PoseableMeshComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
 #include "Logging/LogMacros.h"  
+#include "VisibilityRecording.h"
 
 // Define the log category for LineOfSightComponent    
 DEFINE_LOG_CATEGORY(LogLineOfSightComponent);
 
+namespace LineOfSight
+{
+    // Channel the cone is traced on  
+    static const ECollisionChannel VisibilityTraceChannel = ECC_GameTraceChannel1;
+
+    // True if any of the actor's registered primitives would block the cone's traces. Dead or ragdolled enemies usually  
+    // switch off their capsule or change its response rather than the actor-level collision flag, so check the components.  
+    static bool BlocksVisibilityTrace(const AActor* Actor)
+    {
+        if (!Actor->GetActorEnableCollision())
+        {
+            return false;
+        }
+
+        TInlineComponentArray<UPrimitiveComponent*> PrimitiveComponents(Actor);
+        for (const UPrimitiveComponent* PrimitiveComponent : PrimitiveComponents)
+        {
+            if (PrimitiveComponent->IsRegistered()
+                && PrimitiveComponent->IsQueryCollisionEnabled()
+                && PrimitiveComponent->GetCollisionResponseToChannel(VisibilityTraceChannel) == ECR_Block)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
 
 ULineOfSightComponent::ULineOfSightComponent()
 {
@@ -25,6 +58,7 @@ ULineOfSightComponent::ULineOfSightComponent()
     NumberOfTraces = 50;
     bDrawDebug = false;
     bIsLineOfSightEnabled = true;
+    bRecordVisibility = false;
 }
 
 void ULineOfSightComponent::BeginPlay()
@@ -32,6 +66,11 @@ void ULineOfSightComponent::BeginPlay()
     Super::BeginPlay();
     // Set up the timer to call TimerPerformConeTrace every 0.2 seconds (or whatever interval you prefer)      
     GetWorld()->GetTimerManager().SetTimer(VisibilityCheckTimerHandle, this, &ULineOfSightComponent::PerformConeTrace, 0.2f, true);
+
+    if (bRecordVisibility || FParse::Param(FCommandLine::Get(), TEXT("RecordVisibility")))
+    {
+        StartVisibilityRecording();
+    }
 }
 
 void ULineOfSightComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
@@ -75,50 +114,80 @@ void ULineOfSightComponent::PerformVisibilityCheck(TSet<AActor*>& OutCurrentlyVi
         EyeRotation = OwnerCharacter->GetActorRotation();
     }
 
+    FLineOfSightCone Cone;
+    Cone.TraceDistance = TraceDistance;
+    Cone.ConeAngleHorizontal = ConeAngleHorizontal;
+    Cone.ConeAngleVertical = ConeAngleVertical;
+    Cone.NumberOfTraces = NumberOfTraces;
+    Cone.VisibleActorTag = VisibleActorTag;
+
+    TraceCone(GetWorld(), EyeLocation, EyeRotation, Cone, OwnerCharacter, bDrawDebug, OutCurrentlyVisibleEnemies);
+
+    for (AActor* VisibleActor : OutCurrentlyVisibleEnemies)
+    {
+        IEnemyVisibilityInterface::Execute_SetVisible(VisibleActor, true);
+        UE_LOG(LogLineOfSightComponent, Log, TEXT("Actor %s is now VISIBLE"), *VisibleActor->GetName());
+    }
+
+    if (VisibilityRecorder.IsValid())
+    {
+        RecordVisibilityCheck(EyeLocation, EyeRotation, Cone, OutCurrentlyVisibleEnemies);
+    }
+}
+
+void ULineOfSightComponent::TraceCone(UWorld* World, const FVector& EyeLocation, const FRotator& EyeRotation, const FLineOfSightCone& Cone, const AActor* IgnoredActor, bool bInDrawDebug, TSet<AActor*>& OutVisibleActors)
+{
+    if (!World || Cone.NumberOfTraces <= 0 || Cone.ConeAngleHorizontal <= 0.0f || Cone.ConeAngleVertical <= 0.0f)
+    {
+        return;
+    }
+
     FVector StartTrace = EyeLocation;
     FVector EndTrace;
 
     // Calculate the number of traces for horizontal and vertical directions  
-    int32 NumberOfHorizontalTraces = FMath::CeilToInt(FMath::Sqrt(NumberOfTraces * (ConeAngleHorizontal / ConeAngleVertical)));
-    int32 NumberOfVerticalTraces = FMath::Max(3, NumberOfTraces / NumberOfHorizontalTraces); // At least 3 vertical traces  
+    int32 NumberOfHorizontalTraces = FMath::CeilToInt(FMath::Sqrt(Cone.NumberOfTraces * (Cone.ConeAngleHorizontal / Cone.ConeAngleVertical)));
+    if (NumberOfHorizontalTraces <= 0)
+    {
+        return;
+    }
+    int32 NumberOfVerticalTraces = FMath::Max(3, Cone.NumberOfTraces / NumberOfHorizontalTraces); // At least 3 vertical traces  
 
-    float DeltaHorizontalAngle = ConeAngleHorizontal / NumberOfHorizontalTraces;
-    float DeltaVerticalAngle = ConeAngleVertical / NumberOfVerticalTraces;
+    float DeltaHorizontalAngle = Cone.ConeAngleHorizontal / NumberOfHorizontalTraces;
+    float DeltaVerticalAngle = Cone.ConeAngleVertical / NumberOfVerticalTraces;
+
+    FCollisionQueryParams QueryParams;
+    QueryParams.AddIgnoredActor(IgnoredActor);
+    QueryParams.bReturnPhysicalMaterial = false;
 
     for (int32 i = 0; i < NumberOfHorizontalTraces; ++i)
     {
         for (int32 j = 0; j < NumberOfVerticalTraces; ++j)
         {
-            float CurrentHorizontalAngle = -ConeAngleHorizontal / 2 + i * DeltaHorizontalAngle;
-            float CurrentVerticalAngle = -ConeAngleVertical / 2 + j * DeltaVerticalAngle;
+            float CurrentHorizontalAngle = -Cone.ConeAngleHorizontal / 2 + i * DeltaHorizontalAngle;
+            float CurrentVerticalAngle = -Cone.ConeAngleVertical / 2 + j * DeltaVerticalAngle;
 
             FRotator TraceRotation = EyeRotation + FRotator(CurrentVerticalAngle, CurrentHorizontalAngle, 0);
             FVector TraceDirection = TraceRotation.Vector();
-            EndTrace = StartTrace + TraceDirection * TraceDistance;
+            EndTrace = StartTrace + TraceDirection * Cone.TraceDistance;
 
             FHitResult HitResult;
-            FCollisionQueryParams QueryParams;
-            QueryParams.AddIgnoredActor(OwnerCharacter);
-            QueryParams.bReturnPhysicalMaterial = false;
-
-            bool bHit = GetWorld()->LineTraceSingleByChannel(
+            bool bHit = World->LineTraceSingleByChannel(
                 HitResult,
                 StartTrace,
                 EndTrace,
-                ECC_GameTraceChannel1,
+                LineOfSight::VisibilityTraceChannel,
                 QueryParams
             );
 
             if (bHit)
             {
                 AActor* HitActor = HitResult.GetActor();
-                if (HitActor && HitActor->ActorHasTag(VisibleActorTag))
+                if (HitActor && HitActor->ActorHasTag(Cone.VisibleActorTag))
                 {
                     if (HitActor->GetClass()->ImplementsInterface(UEnemyVisibilityInterface::StaticClass()))
                     {
-                        OutCurrentlyVisibleEnemies.Add(HitActor);
-                        IEnemyVisibilityInterface::Execute_SetVisible(HitActor, true);
-                        UE_LOG(LogLineOfSightComponent, Log, TEXT("Actor %s is now VISIBLE"), *HitActor->GetName());
+                        OutVisibleActors.Add(HitActor);
                     }
                     else
                     {
@@ -128,9 +197,9 @@ void ULineOfSightComponent::PerformVisibilityCheck(TSet<AActor*>& OutCurrentlyVi
             }
 
             // Debug drawing for line traces  
-            if (bDrawDebug)
+            if (bInDrawDebug)
             {
-                DrawDebugLine(GetWorld(), StartTrace, EndTrace, bHit ? FColor::Red : FColor::Green, false, 0.2f, 0, 1.0f);
+                DrawDebugLine(World, StartTrace, EndTrace, bHit ? FColor::Red : FColor::Green, false, 0.2f, 0, 1.0f);
             }
         }
     }
@@ -266,6 +335,60 @@ void ULineOfSightComponent::DestroyGhostActor(AActor* EnemyActor)
     }
 }
 
+void ULineOfSightComponent::StartVisibilityRecording()
+{
+    const FString RecordingFilename = FPaths::ProjectSavedDir() / TEXT("VisibilityRecordings") / FString::Printf(TEXT("%s_%s_%s.vrec"), *GetOwner()->GetName(), *FDateTime::Now().ToString(), *FGuid::NewGuid().ToString());
+
+    TSharedPtr<FVisibilityRecordWriter> Writer = MakeShared<FVisibilityRecordWriter>();
+    if (Writer->Open(RecordingFilename))
+    {
+        VisibilityRecorder = Writer;
+        UE_LOG(LogLineOfSightComponent, Log, TEXT("Recording visibility checks to %s"), *RecordingFilename);
+    }
+}
+
+void ULineOfSightComponent::RecordVisibilityCheck(const FVector& EyeLocation, const FRotator& EyeRotation, const FLineOfSightCone& Cone, const TSet<AActor*>& CurrentlyVisibleEnemies)
+{
+    FVisibilityRecordFrame Frame;
+    Frame.WorldTime = GetWorld()->GetTimeSeconds();
+    Frame.ObserverIndex = VisibilityRecorder->InternString(GetOwner()->GetName());
+    Frame.EyeLocation = EyeLocation;
+    Frame.EyeRotation = EyeRotation;
+    Frame.Cone = Cone;
+
+    // Every tagged actor is recorded, visible or not, so the replayer can rebuild the scene the cone was traced against.  
+    // Pawns (the owner, other observers, players) are recorded too since they block traces without carrying the tag.  
+    TArray<AActor*> RecordedActors;
+    UGameplayStatics::GetAllActorsWithTag(GetWorld(), Cone.VisibleActorTag, RecordedActors);
+    for (TActorIterator<APawn> It(GetWorld()); It; ++It)
+    {
+        RecordedActors.AddUnique(*It);
+    }
+    RecordedActors.AddUnique(GetOwner());
+
+    Frame.Actors.Reserve(RecordedActors.Num());
+    for (AActor* RecordedActor : RecordedActors)
+    {
+        FVisibilityRecordActor& RecordActor = Frame.Actors.AddDefaulted_GetRef();
+        RecordActor.NameIndex = VisibilityRecorder->InternString(RecordedActor->GetName());
+        RecordActor.ClassIndex = VisibilityRecorder->InternString(RecordedActor->GetClass()->GetPathName());
+        RecordActor.Transform = RecordedActor->GetActorTransform();
+        RecordActor.bBlocksVisibility = LineOfSight::BlocksVisibilityTrace(RecordedActor);
+    }
+
+    Frame.VisibleActorIndices.Reserve(CurrentlyVisibleEnemies.Num());
+    for (AActor* VisibleActor : CurrentlyVisibleEnemies)
+    {
+        Frame.VisibleActorIndices.Add(VisibilityRecorder->InternString(VisibleActor->GetName()));
+    }
+
+    if (!VisibilityRecorder->WriteFrame(Frame))
+    {
+        UE_LOG(LogLineOfSightComponent, Warning, TEXT("Visibility recording failed, stopping recorder"));
+        VisibilityRecorder.Reset();
+    }
+}
+
 void ULineOfSightComponent::DisableLineOfSightAndCleanup()
 {
     // Disable the line of sight functionality  
@@ -290,6 +413,13 @@ void ULineOfSightComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
     {  
         GetWorld()->GetTimerManager().ClearTimer(VisibilityCheckTimerHandle);  
     }  
+
+    // Flush and close the recording file  
+    if (VisibilityRecorder.IsValid())
+    {
+        VisibilityRecorder->Close();
+        VisibilityRecorder.Reset();
+    }
   
     // Destroy all ghost actors to clean up  
     for (auto& GhostPair : GhostActorsMap)  
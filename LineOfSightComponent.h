@@ -21,6 +21,24 @@ struct FGhostInfo
     }
 };
 
+// Cone parameters used by a single visibility check  
+struct FLineOfSightCone
+{
+    float TraceDistance;
+    float ConeAngleHorizontal;
+    float ConeAngleVertical;
+    int32 NumberOfTraces;
+    FName VisibleActorTag;
+
+    // Constructor  
+    FLineOfSightCone()
+        : TraceDistance(0.0f), ConeAngleHorizontal(0.0f), ConeAngleVertical(0.0f), NumberOfTraces(0), VisibleActorTag(NAME_None)
+    {
+    }
+};
+
+class FVisibilityRecordWriter;
+
 
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
 class TOPDOWNSHOOTERPRO_API ULineOfSightComponent : public UActorComponent
@@ -72,11 +90,20 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "LineOfSight")
     UMaterialInterface* GhostMaterial;
 
+    // Record every visibility check to Saved/VisibilityRecordings for offline replay (also enabled by -RecordVisibility)  
+    UPROPERTY(EditAnywhere, Category = "LineOfSight")
+    bool bRecordVisibility;
+
+    // Traces the cone from the given eye and collects the tagged actors that implement IEnemyVisibilityInterface.  
+    // Has no side effects on the hit actors, so it is shared by the component and the offline replayer.  
+    static void TraceCone(UWorld* World, const FVector& EyeLocation, const FRotator& EyeRotation, const FLineOfSightCone& Cone, const AActor* IgnoredActor, bool bInDrawDebug, TSet<AActor*>& OutVisibleActors);
+
 private:
     void PerformConeTrace();
     TSet<AActor*> VisibleEnemies;
     FTimerHandle VisibilityCheckTimerHandle;
     TMap<AActor*, FGhostInfo> GhostActorsMap;
+    TSharedPtr<FVisibilityRecordWriter> VisibilityRecorder;
 
     void PerformVisibilityCheck(TSet<AActor*>& OutCurrentlyVisibleEnemies);
     void UpdateVisibilityStates(const TSet<AActor*>& CurrentlyVisibleEnemies);
@@ -84,4 +111,6 @@ private:
     void SpawnGhostActor(AActor* EnemyActor);
     void UpdateGhostActors(const TSet<AActor*>& CurrentlyVisibleEnemies);
     void DestroyGhostActor(AActor* EnemyActor);
+    void StartVisibilityRecording();
+    void RecordVisibilityCheck(const FVector& EyeLocation, const FRotator& EyeRotation, const FLineOfSightCone& Cone, const TSet<AActor*>& CurrentlyVisibleEnemies);
 };
\ No newline at end of file
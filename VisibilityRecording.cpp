@@ -0,0 +1,289 @@
+// VisibilityRecording.cpp
+#include "VisibilityRecording.h"
+#include "HAL/FileManager.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace VisibilityRecording
+{
+    static const uint32 Magic = 0x43455256; // "VREC"
+    static const uint32 Version = 3;
+
+    // Flush every 25 checks (5 seconds at the component's 0.2s interval) so a crash loses little of the match
+    static const int32 FlushInterval = 25;
+
+    // Anything above this is treated as corruption rather than traced, since the replayer would effectively hang
+    static const int32 MaxNumberOfTraces = 100000;
+
+    // Smallest possible size of a serialized actor: name and class indices, a float transform and the blocking flag
+    static const int64 MinActorRecordSize = sizeof(int32) * 2 + sizeof(float) * 10 + sizeof(uint8);
+}
+
+FVisibilityRecordWriter::~FVisibilityRecordWriter()
+{
+    Close();
+}
+
+bool FVisibilityRecordWriter::Open(const FString& Filename)
+{
+    Close();
+
+    FileWriter.Reset(IFileManager::Get().CreateFileWriter(*Filename));
+    if (!FileWriter.IsValid())
+    {
+        UE_LOG(LogLineOfSightComponent, Warning, TEXT("Could not open visibility recording %s for writing"), *Filename);
+        return false;
+    }
+
+    uint32 Magic = VisibilityRecording::Magic;
+    uint32 Version = VisibilityRecording::Version;
+    *FileWriter << Magic;
+    *FileWriter << Version;
+    return !FileWriter->IsError();
+}
+
+int32 FVisibilityRecordWriter::InternString(const FString& String)
+{
+    if (const int32* ExistingIndex = StringTable.Find(String))
+    {
+        return *ExistingIndex;
+    }
+
+    const int32 NewIndex = StringTable.Num();
+    StringTable.Add(String, NewIndex);
+    PendingStrings.Add(String);
+    return NewIndex;
+}
+
+bool FVisibilityRecordWriter::WriteFrame(const FVisibilityRecordFrame& Frame)
+{
+    if (!FileWriter.IsValid())
+    {
+        return false;
+    }
+
+    int32 TagIndex = InternString(Frame.Cone.VisibleActorTag.ToString());
+
+    // Build the frame in memory first so it can be written behind its size
+    FrameBuffer.Reset();
+    FMemoryWriter Ar(FrameBuffer);
+    Ar << PendingStrings;
+
+    float WorldTime = Frame.WorldTime;
+    int32 ObserverIndex = Frame.ObserverIndex;
+    FVector EyeLocation = Frame.EyeLocation;
+    FRotator EyeRotation = Frame.EyeRotation;
+    float TraceDistance = Frame.Cone.TraceDistance;
+    float ConeAngleHorizontal = Frame.Cone.ConeAngleHorizontal;
+    float ConeAngleVertical = Frame.Cone.ConeAngleVertical;
+    int32 NumberOfTraces = Frame.Cone.NumberOfTraces;
+    Ar << WorldTime << ObserverIndex << EyeLocation << EyeRotation;
+    Ar << TraceDistance << ConeAngleHorizontal << ConeAngleVertical << NumberOfTraces << TagIndex;
+
+    int32 NumActors = Frame.Actors.Num();
+    Ar << NumActors;
+    for (const FVisibilityRecordActor& Actor : Frame.Actors)
+    {
+        int32 NameIndex = Actor.NameIndex;
+        int32 ClassIndex = Actor.ClassIndex;
+        FTransform Transform = Actor.Transform;
+        uint8 bBlocksVisibility = Actor.bBlocksVisibility ? 1 : 0;
+        Ar << NameIndex << ClassIndex << Transform << bBlocksVisibility;
+    }
+
+    TArray<int32> VisibleActorIndices = Frame.VisibleActorIndices;
+    Ar << VisibleActorIndices;
+
+    int32 FrameSize = FrameBuffer.Num();
+    *FileWriter << FrameSize;
+    FileWriter->Serialize(FrameBuffer.GetData(), FrameSize);
+    PendingStrings.Reset();
+
+    if (++FramesSinceFlush >= VisibilityRecording::FlushInterval)
+    {
+        FileWriter->Flush();
+        FramesSinceFlush = 0;
+    }
+    return !FileWriter->IsError();
+}
+
+void FVisibilityRecordWriter::Close()
+{
+    if (FileWriter.IsValid())
+    {
+        FileWriter->Close();
+        FileWriter.Reset();
+    }
+    StringTable.Empty();
+    PendingStrings.Empty();
+    FramesSinceFlush = 0;
+}
+
+bool FVisibilityRecordReader::Open(const FString& Filename)
+{
+    StringTable.Empty();
+    bTruncated = false;
+    bError = false;
+
+    FileReader.Reset(IFileManager::Get().CreateFileReader(*Filename));
+    if (!FileReader.IsValid())
+    {
+        UE_LOG(LogLineOfSightComponent, Warning, TEXT("Could not open visibility recording %s for reading"), *Filename);
+        return false;
+    }
+
+    uint32 Magic = 0;
+    uint32 Version = 0;
+    *FileReader << Magic;
+    *FileReader << Version;
+    if (FileReader->IsError() || Magic != VisibilityRecording::Magic || Version != VisibilityRecording::Version)
+    {
+        UE_LOG(LogLineOfSightComponent, Warning, TEXT("%s is not a supported visibility recording (magic 0x%08x, version %u)"), *Filename, Magic, Version);
+        FileReader.Reset();
+        bError = true;
+        return false;
+    }
+    return true;
+}
+
+bool FVisibilityRecordReader::ReadFrame(FVisibilityRecordFrame& OutFrame)
+{
+    if (!FileReader.IsValid())
+    {
+        return false;
+    }
+
+    FArchive& FileAr = *FileReader;
+    const int64 FrameOffset = FileAr.Tell();
+    const int64 RemainingBytes = FileAr.TotalSize() - FrameOffset;
+    if (RemainingBytes == 0)
+    {
+        return false;
+    }
+
+    // A crash or a killed server leaves the last frame partially written; everything before it is still valid
+    int32 FrameSize = 0;
+    if (RemainingBytes >= (int64)sizeof(int32))
+    {
+        FileAr << FrameSize;
+    }
+    if (RemainingBytes < (int64)sizeof(int32) || FrameSize > RemainingBytes - (int64)sizeof(int32))
+    {
+        UE_LOG(LogLineOfSightComponent, Warning, TEXT("Visibility recording ends partway through a frame at offset %lld, dropping its last %lld bytes"), FrameOffset, RemainingBytes);
+        bTruncated = true;
+        FileReader.Reset();
+        return false;
+    }
+
+    bool bParsed = false;
+    if (!FileAr.IsError() && FrameSize > 0)
+    {
+        FrameBuffer.SetNumUninitialized(FrameSize);
+        FileAr.Serialize(FrameBuffer.GetData(), FrameSize);
+
+        FMemoryReader FrameAr(FrameBuffer);
+        FrameAr.ArMaxSerializeSize = FrameSize; // Keeps a corrupt string length from turning into a huge allocation
+        bParsed = !FileAr.IsError() && ParseFrame(FrameAr, OutFrame) && FrameAr.Tell() == FrameSize;
+    }
+
+    if (!bParsed)
+    {
+        // The string table may no longer match the file, so don't allow reading past this point
+        UE_LOG(LogLineOfSightComponent, Warning, TEXT("Visibility recording has a corrupt frame at offset %lld"), FrameOffset);
+        bError = true;
+        FileReader.Reset();
+        StringTable.Empty();
+        return false;
+    }
+    return true;
+}
+
+bool FVisibilityRecordReader::ReadCount(FArchive& Ar, int64 MinElementSize, int32& OutCount) const
+{
+    OutCount = 0;
+    Ar << OutCount;
+
+    const int64 RemainingBytes = Ar.TotalSize() - Ar.Tell();
+    return !Ar.IsError() && OutCount >= 0 && OutCount <= RemainingBytes / MinElementSize;
+}
+
+bool FVisibilityRecordReader::ReadActor(FArchive& Ar, int32 NumStrings, FVisibilityRecordActor& OutActor) const
+{
+    uint8 bBlocksVisibility = 1;
+    Ar << OutActor.NameIndex << OutActor.ClassIndex << OutActor.Transform << bBlocksVisibility;
+    OutActor.bBlocksVisibility = bBlocksVisibility != 0;
+
+    return !Ar.IsError()
+        && OutActor.NameIndex >= 0 && OutActor.NameIndex < NumStrings
+        && OutActor.ClassIndex >= 0 && OutActor.ClassIndex < NumStrings
+        && !OutActor.Transform.ContainsNaN();
+}
+
+bool FVisibilityRecordReader::ParseFrame(FArchive& Ar, FVisibilityRecordFrame& OutFrame)
+{
+    // New strings only join the table once the whole frame is known to be valid
+    int32 NumNewStrings = 0;
+    if (!ReadCount(Ar, sizeof(int32), NumNewStrings))
+    {
+        return false;
+    }
+    TArray<FString> NewStrings;
+    NewStrings.SetNum(NumNewStrings);
+    for (FString& NewString : NewStrings)
+    {
+        Ar << NewString;
+    }
+    const int32 NumStrings = StringTable.Num() + NumNewStrings;
+    auto IsValidStringIndex = [NumStrings](int32 Index) { return Index >= 0 && Index < NumStrings; };
+
+    int32 TagIndex = INDEX_NONE;
+    Ar << OutFrame.WorldTime << OutFrame.ObserverIndex << OutFrame.EyeLocation << OutFrame.EyeRotation;
+    Ar << OutFrame.Cone.TraceDistance << OutFrame.Cone.ConeAngleHorizontal << OutFrame.Cone.ConeAngleVertical << OutFrame.Cone.NumberOfTraces << TagIndex;
+
+    // These go straight into ULineOfSightComponent::TraceCone, so reject anything it can't trace sensibly
+    const FLineOfSightCone& Cone = OutFrame.Cone;
+    if (Ar.IsError()
+        || !IsValidStringIndex(OutFrame.ObserverIndex) || !IsValidStringIndex(TagIndex)
+        || !FMath::IsFinite(OutFrame.WorldTime) || OutFrame.EyeLocation.ContainsNaN() || OutFrame.EyeRotation.ContainsNaN()
+        || !FMath::IsFinite(Cone.TraceDistance) || Cone.TraceDistance < 0.0f
+        || !FMath::IsFinite(Cone.ConeAngleHorizontal) || Cone.ConeAngleHorizontal <= 0.0f
+        || !FMath::IsFinite(Cone.ConeAngleVertical) || Cone.ConeAngleVertical <= 0.0f
+        || Cone.NumberOfTraces <= 0 || Cone.NumberOfTraces > VisibilityRecording::MaxNumberOfTraces)
+    {
+        return false;
+    }
+    const FString& TagString = TagIndex < StringTable.Num() ? StringTable[TagIndex] : NewStrings[TagIndex - StringTable.Num()];
+    OutFrame.Cone.VisibleActorTag = FName(*TagString);
+
+    int32 NumActors = 0;
+    if (!ReadCount(Ar, VisibilityRecording::MinActorRecordSize, NumActors))
+    {
+        return false;
+    }
+    OutFrame.Actors.SetNum(NumActors);
+    for (FVisibilityRecordActor& Actor : OutFrame.Actors)
+    {
+        if (!ReadActor(Ar, NumStrings, Actor))
+        {
+            return false;
+        }
+    }
+
+    int32 NumVisible = 0;
+    if (!ReadCount(Ar, sizeof(int32), NumVisible))
+    {
+        return false;
+    }
+    OutFrame.VisibleActorIndices.SetNum(NumVisible);
+    for (int32& VisibleIndex : OutFrame.VisibleActorIndices)
+    {
+        Ar << VisibleIndex;
+        if (Ar.IsError() || !IsValidStringIndex(VisibleIndex))
+        {
+            return false;
+        }
+    }
+
+    StringTable.Append(MoveTemp(NewStrings));
+    return true;
+}
@@ -0,0 +1,89 @@
+// VisibilityRecording.h
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LineOfSightComponent.h"
+
+// An actor as it was placed when a visibility check ran. Names and class paths are indices into the recording's string table.
+struct FVisibilityRecordActor
+{
+    int32 NameIndex;
+    int32 ClassIndex; // Used by the replayer to spawn actors that don't exist in the loaded map
+    FTransform Transform;
+    bool bBlocksVisibility; // Whether any of the actor's primitives blocked the visibility trace channel
+
+    // Constructor
+    FVisibilityRecordActor()
+        : NameIndex(INDEX_NONE), ClassIndex(INDEX_NONE), bBlocksVisibility(true)
+    {
+    }
+};
+
+// Everything needed to rerun one ULineOfSightComponent visibility check offline
+struct FVisibilityRecordFrame
+{
+    float WorldTime;
+    int32 ObserverIndex; // Name of the component's owner; the owner itself is one of the recorded actors
+    FVector EyeLocation;
+    FRotator EyeRotation;
+    FLineOfSightCone Cone;
+    TArray<FVisibilityRecordActor> Actors;
+    TArray<int32> VisibleActorIndices;
+
+    // Constructor
+    FVisibilityRecordFrame()
+        : WorldTime(0.0f), ObserverIndex(INDEX_NONE), EyeLocation(ForceInitToZero), EyeRotation(ForceInitToZero)
+    {
+    }
+};
+
+// Streams visibility frames to a binary file.
+// Strings (actor names, class paths, tags) are interned: each is written once, ahead of the first frame that uses it,
+// and referenced by index afterwards, so a frame is mostly transforms and indices.
+// Every frame is length-prefixed so a reader can tell a file cut off by a crash from a corrupt one.
+class TOPDOWNSHOOTERPRO_API FVisibilityRecordWriter
+{
+public:
+    ~FVisibilityRecordWriter();
+
+    bool Open(const FString& Filename);
+    bool WriteFrame(const FVisibilityRecordFrame& Frame);
+    void Close();
+    bool IsOpen() const { return FileWriter.IsValid(); }
+
+    // Returns the index of String in the recording's string table, adding it if this is its first use
+    int32 InternString(const FString& String);
+
+private:
+    TUniquePtr<FArchive> FileWriter;
+    TMap<FString, int32> StringTable;
+    TArray<FString> PendingStrings; // Interned since the last frame was written
+    TArray<uint8> FrameBuffer;
+    int32 FramesSinceFlush = 0;
+};
+
+// Reads back frames written by FVisibilityRecordWriter
+class TOPDOWNSHOOTERPRO_API FVisibilityRecordReader
+{
+public:
+    bool Open(const FString& Filename);
+
+    // Returns false at the end of the file, or when the next frame is cut off or corrupt.
+    // A cut-off frame (IsTruncated) keeps every complete frame and the string table usable; a corrupt one (HasError) does not.
+    bool ReadFrame(FVisibilityRecordFrame& OutFrame);
+    bool IsTruncated() const { return bTruncated; }
+    bool HasError() const { return bError; }
+
+    const TArray<FString>& GetStringTable() const { return StringTable; }
+
+private:
+    bool ParseFrame(FArchive& Ar, FVisibilityRecordFrame& OutFrame);
+    bool ReadCount(FArchive& Ar, int64 MinElementSize, int32& OutCount) const;
+    bool ReadActor(FArchive& Ar, int32 NumStrings, FVisibilityRecordActor& OutActor) const;
+
+    TUniquePtr<FArchive> FileReader;
+    TArray<FString> StringTable;
+    TArray<uint8> FrameBuffer;
+    bool bTruncated = false;
+    bool bError = false;
+};
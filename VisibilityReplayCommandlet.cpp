@@ -0,0 +1,272 @@
+// VisibilityReplayCommandlet.cpp
+#include "VisibilityReplayCommandlet.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "HAL/PlatformTime.h"
+#include "UObject/Package.h"
+#include "LineOfSightComponent.h"
+#include "VisibilityRecording.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogVisibilityReplay, Log, All);
+
+namespace VisibilityReplay
+{
+    // Maps the recording's string indices to actors in the replay world. Each name is resolved once, the first time
+    // a frame references it, so the per-frame loop only does array lookups.
+    struct FReplayActors
+    {
+        FReplayActors(UWorld* InWorld, const TArray<FString>& InStrings)
+            : World(InWorld), Strings(InStrings)
+        {
+            ActorsByStringIndex.Init(nullptr, Strings.Num());
+            ResolvedStrings.Init(false, Strings.Num());
+            for (TActorIterator<AActor> It(World); It; ++It)
+            {
+                WorldActorsByName.Add(It->GetName(), *It);
+            }
+        }
+
+        // Finds the replay world's actor for a recorded actor, spawning it from the recorded class if the map doesn't contain it
+        AActor* Resolve(const FVisibilityRecordActor& RecordActor)
+        {
+            if (ResolvedStrings[RecordActor.NameIndex])
+            {
+                return ActorsByStringIndex[RecordActor.NameIndex];
+            }
+            ResolvedStrings[RecordActor.NameIndex] = true; // Only resolve, or warn, once per actor
+
+            const FString& Name = Strings[RecordActor.NameIndex];
+            AActor* Actor = WorldActorsByName.FindRef(Name);
+            if (!Actor)
+            {
+                const FString& ClassPath = Strings[RecordActor.ClassIndex];
+                UClass* ActorClass = LoadObject<UClass>(nullptr, *ClassPath);
+                if (!ActorClass || !ActorClass->IsChildOf(AActor::StaticClass()))
+                {
+                    UE_LOG(LogVisibilityReplay, Warning, TEXT("Could not load class %s for recorded actor %s"), *ClassPath, *Name);
+                    return nullptr;
+                }
+
+                FActorSpawnParameters SpawnParams;
+                SpawnParams.Name = FName(*Name);
+                SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+                Actor = World->SpawnActor<AActor>(ActorClass, RecordActor.Transform, SpawnParams);
+            }
+
+            if (Actor)
+            {
+                ActorsByStringIndex[RecordActor.NameIndex] = Actor;
+                StringIndexByActor.Add(Actor, RecordActor.NameIndex);
+            }
+            return Actor;
+        }
+
+        UWorld* World;
+        const TArray<FString>& Strings;
+        TMap<FString, AActor*> WorldActorsByName;
+        TArray<AActor*> ActorsByStringIndex;
+        TBitArray<> ResolvedStrings;
+        TMap<AActor*, int32> StringIndexByActor;
+    };
+
+    static FString JoinNames(const TSet<int32>& StringIndices, const TArray<FString>& Strings)
+    {
+        TArray<FString> Names;
+        for (int32 StringIndex : StringIndices)
+        {
+            Names.Add(Strings[StringIndex]);
+        }
+        return FString::Join(Names, TEXT(", "));
+    }
+}
+
+UVisibilityReplayCommandlet::UVisibilityReplayCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = true;
+    LogToConsole = true;
+}
+
+int32 UVisibilityReplayCommandlet::Main(const FString& Params)
+{
+    FString RecordingFilename;
+    FString MapName;
+    int32 Iterations = 1;
+    if (!FParse::Value(*Params, TEXT("Recording="), RecordingFilename) || !FParse::Value(*Params, TEXT("Map="), MapName))
+    {
+        UE_LOG(LogVisibilityReplay, Error, TEXT("Usage: -run=VisibilityReplay -Recording=<file.vrec> -Map=<map package> [-Iterations=N]"));
+        return 1;
+    }
+    FParse::Value(*Params, TEXT("Iterations="), Iterations);
+    Iterations = FMath::Max(1, Iterations);
+
+    // Load the whole recording up front so file IO doesn't show up in the trace timings
+    TArray<FVisibilityRecordFrame> Frames;
+    FVisibilityRecordReader Reader;
+    if (!Reader.Open(RecordingFilename))
+    {
+        return 1;
+    }
+    FVisibilityRecordFrame Frame;
+    while (Reader.ReadFrame(Frame))
+    {
+        Frames.Add(Frame);
+    }
+    if (Reader.HasError())
+    {
+        UE_LOG(LogVisibilityReplay, Error, TEXT("%s is corrupt at frame %d"), *RecordingFilename, Frames.Num());
+        return 1;
+    }
+    if (Reader.IsTruncated())
+    {
+        // Expected for recordings from crashed or killed matches
+        UE_LOG(LogVisibilityReplay, Warning, TEXT("%s ends partway through frame %d, replaying the %d complete frames"), *RecordingFilename, Frames.Num(), Frames.Num());
+    }
+    if (Frames.Num() == 0)
+    {
+        UE_LOG(LogVisibilityReplay, Error, TEXT("%s contains no frames"), *RecordingFilename);
+        return 1;
+    }
+    UE_LOG(LogVisibilityReplay, Display, TEXT("Loaded %d frames from %s"), Frames.Num(), *RecordingFilename);
+
+    UPackage* MapPackage = LoadPackage(nullptr, *MapName, LOAD_None);
+    UWorld* World = MapPackage ? UWorld::FindWorldInPackage(MapPackage) : nullptr;
+    if (!World)
+    {
+        UE_LOG(LogVisibilityReplay, Error, TEXT("Could not load map %s"), *MapName);
+        return 1;
+    }
+
+    // Bring up collision only; nothing is rendered, simulated or begun play
+    World->AddToRoot();
+    World->WorldType = EWorldType::Editor;
+    World->InitWorld(UWorld::InitializationValues()
+        .ShouldSimulatePhysics(false)
+        .EnableTraceCollision(true)
+        .CreatePhysicsScene(true)
+        .CreateNavigation(false)
+        .CreateAISystem(false)
+        .AllowAudioPlayback(false));
+    World->UpdateWorldComponents(true, false);
+    World->FlushLevelStreaming(EFlushLevelStreamingType::Full);
+
+    TSet<FName> RecordedTags;
+    for (const FVisibilityRecordFrame& RecordedFrame : Frames)
+    {
+        RecordedTags.Add(RecordedFrame.Cone.VisibleActorTag);
+    }
+
+    // Tagged actors and pawns that aren't part of a frame must not block or satisfy that frame's traces
+    TSet<AActor*> ManagedActors;
+    for (TActorIterator<AActor> It(World); It; ++It)
+    {
+        if (It->IsA<APawn>())
+        {
+            ManagedActors.Add(*It);
+            continue;
+        }
+        for (const FName& Tag : RecordedTags)
+        {
+            if (It->ActorHasTag(Tag))
+            {
+                ManagedActors.Add(*It);
+                break;
+            }
+        }
+    }
+
+    const TArray<FString>& Strings = Reader.GetStringTable();
+    VisibilityReplay::FReplayActors ReplayActors(World, Strings);
+
+    int32 MismatchedFrames = 0;
+    double TotalTraceSeconds = 0.0;
+    double MaxTraceSeconds = 0.0;
+
+    for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+    {
+        for (int32 FrameIndex = 0; FrameIndex < Frames.Num(); ++FrameIndex)
+        {
+            const FVisibilityRecordFrame& RecordedFrame = Frames[FrameIndex];
+
+            TSet<AActor*> PlacedActors;
+            for (const FVisibilityRecordActor& RecordActor : RecordedFrame.Actors)
+            {
+                AActor* Actor = ReplayActors.Resolve(RecordActor);
+                if (Actor)
+                {
+                    Actor->SetActorTransform(RecordActor.Transform, false, nullptr, ETeleportType::TeleportPhysics);
+                    Actor->SetActorEnableCollision(RecordActor.bBlocksVisibility);
+                    PlacedActors.Add(Actor);
+                    ManagedActors.Add(Actor);
+                }
+            }
+            for (AActor* Actor : ManagedActors)
+            {
+                if (!PlacedActors.Contains(Actor))
+                {
+                    Actor->SetActorEnableCollision(false);
+                }
+            }
+
+            // The observer is one of the recorded actors, so it has been placed or spawned above
+            const AActor* ObserverActor = ReplayActors.ActorsByStringIndex[RecordedFrame.ObserverIndex];
+            TSet<AActor*> VisibleActors;
+
+            const double StartSeconds = FPlatformTime::Seconds();
+            ULineOfSightComponent::TraceCone(World, RecordedFrame.EyeLocation, RecordedFrame.EyeRotation, RecordedFrame.Cone, ObserverActor, false, VisibleActors);
+            const double TraceSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+            TotalTraceSeconds += TraceSeconds;
+            MaxTraceSeconds = FMath::Max(MaxTraceSeconds, TraceSeconds);
+
+            // Timings are gathered on every iteration, correctness only needs checking once
+            if (Iteration > 0)
+            {
+                continue;
+            }
+
+            TSet<int32> ReplayedIndices;
+            TArray<FString> UnrecordedNames;
+            for (AActor* VisibleActor : VisibleActors)
+            {
+                if (const int32* StringIndex = ReplayActors.StringIndexByActor.Find(VisibleActor))
+                {
+                    ReplayedIndices.Add(*StringIndex);
+                }
+                else
+                {
+                    UnrecordedNames.Add(VisibleActor->GetName());
+                }
+            }
+            TSet<int32> RecordedIndices(RecordedFrame.VisibleActorIndices);
+
+            TSet<int32> OnlyRecorded = RecordedIndices.Difference(ReplayedIndices);
+            TSet<int32> OnlyReplayed = ReplayedIndices.Difference(RecordedIndices);
+            if (OnlyRecorded.Num() > 0 || OnlyReplayed.Num() > 0 || UnrecordedNames.Num() > 0)
+            {
+                FString NewlyVisible = VisibilityReplay::JoinNames(OnlyReplayed, Strings);
+                for (const FString& UnrecordedName : UnrecordedNames)
+                {
+                    NewlyVisible += NewlyVisible.IsEmpty() ? UnrecordedName : TEXT(", ") + UnrecordedName;
+                }
+
+                ++MismatchedFrames;
+                UE_LOG(LogVisibilityReplay, Warning, TEXT("Frame %d (%s at %.2fs): no longer visible [%s], newly visible [%s]"),
+                    FrameIndex, *Strings[RecordedFrame.ObserverIndex], RecordedFrame.WorldTime,
+                    *VisibilityReplay::JoinNames(OnlyRecorded, Strings), *NewlyVisible);
+            }
+        }
+    }
+
+    const int32 TotalChecks = Frames.Num() * Iterations;
+    UE_LOG(LogVisibilityReplay, Display, TEXT("Replayed %d checks: total %.3f ms, average %.3f us, max %.3f us"),
+        TotalChecks, TotalTraceSeconds * 1000.0, TotalChecks > 0 ? TotalTraceSeconds * 1000000.0 / TotalChecks : 0.0, MaxTraceSeconds * 1000000.0);
+    UE_LOG(LogVisibilityReplay, Display, TEXT("%d of %d frames differ from the recording"), MismatchedFrames, Frames.Num());
+
+    World->DestroyWorld(false);
+    World->RemoveFromRoot();
+
+    return MismatchedFrames > 0 ? 1 : 0;
+}
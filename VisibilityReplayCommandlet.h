@@ -0,0 +1,25 @@
+// VisibilityReplayCommandlet.h
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "VisibilityReplayCommandlet.generated.h"
+
+/**
+ * Replays a visibility recording (see ULineOfSightComponent::bRecordVisibility) through ULineOfSightComponent::TraceCone
+ * against the recorded map, without rendering. Reports trace timings and every frame whose visible set differs from
+ * the recorded one; the exit code is non-zero if any frame differs or the recording is corrupt. A recording cut off by
+ * a crash replays its complete frames.
+ *
+ * UE4Editor-Cmd TopDownShooterPro -run=VisibilityReplay -Recording=<file.vrec> -Map=/Game/Maps/<Map> [-Iterations=N] -nullrhi
+ */
+UCLASS()
+class TOPDOWNSHOOTERPRO_API UVisibilityReplayCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UVisibilityReplayCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+};